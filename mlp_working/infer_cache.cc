@@ -0,0 +1,154 @@
+/*****************************************************
+   Multi-Level Perceptron (MLP) in C++
+   Written by Intelligent Computing Systems Lab (ICSL)
+   School of Electrical Engineering
+   Yonsei University, Seoul,  South Korea
+ *****************************************************/
+
+#include <cstring>
+#include <iostream>
+#include "infer_cache.h"
+
+using namespace std;
+
+infer_cache_t::infer_cache_t(unsigned m_num_entries, unsigned m_num_shards,
+                             unsigned m_input_size, unsigned m_output_size) :
+    num_shards(m_num_shards ? m_num_shards : 1),
+    entries_per_shard(0),
+    input_size(m_input_size),
+    output_size(m_output_size),
+    shards(NULL),
+    generation(0),
+    hits(0),
+    misses(0),
+    saved_ns(0) {
+    // Round up so that the cache holds at least m_num_entries results.
+    entries_per_shard = (m_num_entries + num_shards - 1) / num_shards;
+    if(!entries_per_shard) entries_per_shard = 1;
+
+    shards = new shard_t[num_shards];
+    for(unsigned i = 0; i < num_shards; i++) {
+        shards[i].entries.reserve(entries_per_shard);
+        shards[i].index.reserve(entries_per_shard);
+        shards[i].clock_hand = 0;
+    }
+}
+
+infer_cache_t::~infer_cache_t() {
+    delete [] shards;
+}
+
+uint64_t infer_cache_t::hash(const double *input) {
+    const unsigned char *bytes = (const unsigned char*)input;
+    uint64_t h = 14695981039346656037ULL;
+    for(unsigned i = 0; i < input_size * sizeof(double); i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t infer_cache_t::get_generation() {
+    return generation.load();
+}
+
+bool infer_cache_t::lookup(uint64_t key, const double *input, double *output) {
+    shard_t &shard = shards[key % num_shards];
+    uint64_t current = generation.load();
+    {
+        lock_guard<mutex> guard(shard.lock);
+        unordered_map<uint64_t, unsigned>::iterator it = shard.index.find(key);
+        if(it != shard.index.end()) {
+            entry_t &e = shard.entries[it->second];
+            // Compare the whole image to rule out hash collisions.
+            if(e.generation == current &&
+               !memcmp(&e.input[0], input, input_size * sizeof(double))) {
+                memcpy(output, &e.output[0], output_size * sizeof(double));
+                e.referenced = true;
+                hits++;
+                saved_ns += e.compute_ns;
+                return true;
+            }
+        }
+    }
+    misses++;
+    return false;
+}
+
+void infer_cache_t::insert(uint64_t key, uint64_t m_generation, const double *input,
+                           const double *output, uint64_t compute_ns) {
+    // Result was computed with weights that have been replaced since.
+    if(m_generation != generation.load()) return;
+
+    shard_t &shard = shards[key % num_shards];
+    lock_guard<mutex> guard(shard.lock);
+
+    unsigned slot;
+    unordered_map<uint64_t, unsigned>::iterator it = shard.index.find(key);
+    if(it != shard.index.end()) {
+        slot = it->second;
+    }
+    else if(shard.entries.size() < entries_per_shard) {
+        slot = shard.entries.size();
+        shard.entries.push_back(entry_t());
+        shard.entries[slot].input.resize(input_size);
+        shard.entries[slot].output.resize(output_size);
+    }
+    else {
+        slot = evict(shard);
+    }
+
+    entry_t &e = shard.entries[slot];
+    e.key = key;
+    e.generation = m_generation;
+    e.compute_ns = compute_ns;
+    e.referenced = false;
+    memcpy(&e.input[0], input, input_size * sizeof(double));
+    memcpy(&e.output[0], output, output_size * sizeof(double));
+    shard.index[key] = slot;
+}
+
+// Pick a victim slot with the CLOCK policy. Entries of an old weight
+// generation are reused immediately. Caller must hold the shard lock.
+unsigned infer_cache_t::evict(shard_t &shard) {
+    uint64_t current = generation.load();
+    while(true) {
+        unsigned slot = shard.clock_hand;
+        shard.clock_hand = (shard.clock_hand + 1) % shard.entries.size();
+
+        entry_t &e = shard.entries[slot];
+        if(e.referenced && e.generation == current) {
+            e.referenced = false;
+            continue;
+        }
+        shard.index.erase(e.key);
+        return slot;
+    }
+}
+
+// Weights have changed. Bumping the generation makes every stored result
+// stale without touching the shards; stale slots are recycled by evict().
+void infer_cache_t::invalidate() {
+    generation++;
+}
+
+uint64_t infer_cache_t::get_hits() {
+    return hits.load();
+}
+
+uint64_t infer_cache_t::get_lookups() {
+    return hits.load() + misses.load();
+}
+
+uint64_t infer_cache_t::get_saved_ns() {
+    return saved_ns.load();
+}
+
+void infer_cache_t::print_stats() {
+    uint64_t num_hits = get_hits();
+    uint64_t num_lookups = get_lookups();
+    double hit_rate = num_lookups ? double(num_hits) / double(num_lookups) : 0.0;
+    cout << "Inference cache: " << num_hits << "/" << num_lookups << " hits ("
+         << hit_rate * 100.0 << "%), "
+         << double(get_saved_ns()) / 1e6 << " ms saved" << endl;
+}
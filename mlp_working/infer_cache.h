@@ -0,0 +1,69 @@
+/*****************************************************
+   Multi-Level Perceptron (MLP) in C++
+   Written by Intelligent Computing Systems Lab (ICSL)
+   School of Electrical Engineering
+   Yonsei University, Seoul,  South Korea
+ *****************************************************/
+
+#ifndef __INFER_CACHE_H__
+#define __INFER_CACHE_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Content-hashed inference result cache
+// Maps an input image to the softmax output of the network. Entries are
+// spread over shards that are locked independently, and each shard evicts
+// with the CLOCK (second chance) policy once it is full.
+class infer_cache_t {
+public:
+    infer_cache_t(unsigned m_num_entries, unsigned m_num_shards,
+                  unsigned m_input_size, unsigned m_output_size);   // Cache constructor
+    virtual ~infer_cache_t();                                        // Cache destructor
+
+    uint64_t hash(const double *input);                              // FNV-1a hash of an input image
+    uint64_t get_generation();                                       // Current weight generation
+    bool lookup(uint64_t key, const double *input, double *output);
+    void insert(uint64_t key, uint64_t m_generation, const double *input,
+                const double *output, uint64_t compute_ns);
+    void invalidate();                                               // Drop all results (weights changed)
+    uint64_t get_hits();
+    uint64_t get_lookups();                                          // Hits and misses
+    uint64_t get_saved_ns();                                         // Compute time avoided by hits
+    void print_stats();
+
+private:
+    struct entry_t {
+        uint64_t key;
+        uint64_t generation;
+        uint64_t compute_ns;                                         // Time spent to compute this result
+        bool referenced;                                             // CLOCK reference bit
+        std::vector<double> input;
+        std::vector<double> output;
+    };
+
+    struct shard_t {
+        std::mutex lock;
+        std::vector<entry_t> entries;
+        std::unordered_map<uint64_t, unsigned> index;                // Key -> slot in entries
+        unsigned clock_hand;
+    };
+
+    unsigned evict(shard_t &shard);
+
+    unsigned num_shards;
+    unsigned entries_per_shard;
+    unsigned input_size;
+    unsigned output_size;
+    shard_t *shards;
+
+    std::atomic<uint64_t> generation;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> saved_ns;                                  // Compute time avoided by hits
+};
+
+#endif
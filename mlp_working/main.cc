@@ -71,13 +71,19 @@ int main(int argc, char **argv) {
     mlp_t *mlp = new mlp_t(); //NULL, 0, 0, NULL, NULL, NULL, NULL ); 
     
     mlp->initialize(config_file_name); //, test_img_file_name, test_label_file_name, train_img_file_name, train_label_file_name, weight_file_name);
-	mlp->read_test_img_file();
-    mlp->read_test_label_file();
-    mlp->read_train_img_file();
-    mlp->read_train_label_file();
+    if(mlp->is_async()) {
+        // Loading, training, evaluation and checkpoints run concurrently.
+        mlp->mlp_async();
+    }
+    else {
+        mlp->read_test_img_file();
+        mlp->read_test_label_file();
+        mlp->read_train_img_file();
+        mlp->read_train_label_file();
 
-	//mlp->mlp_training();
-	mlp->mlp_test();
+        //mlp->mlp_training();
+        mlp->mlp_test();
+    }
 
     #ifdef DEBUG
     for(unsigned i = 0; i < num_layers-1; i++) {
@@ -5,6 +5,7 @@
    Yonsei University, Seoul,  South Korea
  *****************************************************/
 
+#include <chrono>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
@@ -23,11 +24,19 @@ mlp_t::mlp_t() :
     neuron(NULL),
     width(0), length(0),
     require_training(false),
+    infer_cache(NULL),
     test_img_set(NULL),
     train_img_set(NULL),
     test_label_set(NULL),
     train_label_set(NULL),
-	answer_set(NULL) {
+	answer_set(NULL),
+    layer_plans(NULL),
+    num_threads(0),
+    eval_interval(0),
+    eval_core_share(0.25),
+    checkpoint_step(0),
+    eval_running(false),
+    checkpoint_running(false) {
 }
 
 mlp_t::~mlp_t() {
@@ -48,6 +57,8 @@ mlp_t::~mlp_t() {
     delete [] train_label_set;
 	delete [] answer_set;
     delete [] num_neurons_per_layer;
+    delete infer_cache;
+    delete [] layer_plans;
     delete [] delta;
 }
 
@@ -139,6 +150,55 @@ void mlp_t::initialize(string m_config_file_name) {
         test_label_set = new double[test_set_size];
         test_img_set = new double[test_set_size * num_neurons_in_input_layer];
 
+        // Load the tuning cache file name. Autotuning is enabled only if it is given.
+        if(mlp_config.exists("tuning_cache")) {
+            tuning_cache_file_name = mlp_config.lookup("tuning_cache").c_str();
+        }
+
+        // Load the scheduler settings. Scheduling is enabled only if num_threads is given.
+        if(mlp_config.exists("num_threads")) {
+            num_threads = unsigned(mlp_config.lookup("num_threads"));
+            if(mlp_config.exists("eval_interval")) {
+                eval_interval = unsigned(mlp_config.lookup("eval_interval"));
+            }
+            if(mlp_config.exists("eval_core_share")) {
+                eval_core_share = double(mlp_config.lookup("eval_core_share"));
+            }
+            if(mlp_config.exists("checkpoint")) {
+                checkpoint_file_name = mlp_config.lookup("checkpoint").c_str();
+            }
+            if(!eval_interval) eval_interval = train_set_size;
+
+            // Training holds one thread, so evaluation needs another.
+            if(num_threads < 2) {
+                cerr << "Error: num_threads must be at least 2" << endl;
+                exit(1);
+            }
+            if(eval_core_share <= 0.0 || eval_core_share > 1.0) {
+                cerr << "Error: eval_core_share must be in (0, 1]" << endl;
+                exit(1);
+            }
+            // Evaluation gets at least one thread, and leaves one for training.
+            unsigned eval_threads = unsigned(eval_core_share * num_threads);
+            if(eval_threads < 1 || eval_threads > num_threads - 1) {
+                cerr << "Error: eval_core_share * num_threads must be between 1 and num_threads - 1" << endl;
+                exit(1);
+            }
+        }
+
+        // Set the inference cache. It is optional, and disabled by default or with 0 entries.
+        if(mlp_config.exists("infer_cache_entries")) {
+            unsigned num_entries = unsigned(mlp_config.lookup("infer_cache_entries"));
+            unsigned num_shards = 16;
+            if(mlp_config.exists("infer_cache_shards")) {
+                num_shards = unsigned(mlp_config.lookup("infer_cache_shards"));
+            }
+            if(num_entries) {
+                infer_cache = new infer_cache_t(num_entries, num_shards,
+                                                num_neurons_in_input_layer, num_neurons_per_layer[total_layers_index]);
+            }
+        }
+
         weights = new double*[total_layers_index];
         for(unsigned i = 0; i < total_layers_index; i++) {
 			weights[i] = new double[(num_neurons_per_layer[i]+1)*num_neurons_per_layer[i+1]];
@@ -152,6 +212,9 @@ void mlp_t::initialize(string m_config_file_name) {
 		cout << "load_weights" << endl;
 		} 
 
+        // Set forward product plans
+        tune_layers();
+
         // Setting delta
         delta = new double*[total_layers_index];
         for(unsigned i = 1; i < num_layers; i++) {
@@ -192,7 +255,7 @@ void mlp_t::read_test_img_file() {
     }
     // Read test image
     data_type_t img;
-    for(unsigned i = 0 ; i < test_set_size ; i++) {
+    for(unsigned i = 0 ; i < test_set_size*num_neurons_in_input_layer ; i++) {
         file_stream.read((char*)&img,sizeof(char));
         test_img_set[i] = img;
     }
@@ -293,6 +356,80 @@ void mlp_t::load_weights() {
             file_stream >> weights [i][j];
         }
     }
+    // Cached results were computed with the old weights.
+    if(infer_cache) { infer_cache->invalidate(); }
+}
+
+// Copy the current weights
+double **mlp_t::snapshot_weights() {
+    double **snapshot = new double*[total_layers_index];
+    for(unsigned i = 0; i < total_layers_index; i++) {
+        unsigned size = (num_neurons_per_layer[i]+1)*num_neurons_per_layer[i+1];
+        snapshot[i] = new double[size];
+        copy(weights[i], weights[i]+size, snapshot[i]);
+    }
+    return snapshot;
+}
+
+void mlp_t::delete_weights(double **m_weights) {
+    for(unsigned i = 0; i < total_layers_index; i++) {
+        delete [] m_weights[i];
+    }
+    delete [] m_weights;
+}
+
+// Export weights in the format load_weights() reads. A checkpoint older
+// than the one already written is dropped.
+void mlp_t::export_weights(double **m_weights, unsigned step) {
+    lock_guard<mutex> guard(checkpoint_lock);
+    if(step < checkpoint_step) return;
+
+    // Write to a temporary file first, so a crash never leaves a partial checkpoint.
+    string tmp_file_name = checkpoint_file_name + ".tmp";
+    fstream file_stream;
+    file_stream.open(tmp_file_name.c_str(), fstream::out|fstream::trunc);
+
+    if(!file_stream.is_open()) {
+        cerr << "Error: failed to open " << tmp_file_name << endl;
+        return;
+    }
+    file_stream.precision(17);
+    for(unsigned i = 0; i < total_layers_index; i++) {
+        for(unsigned j = 0; j < num_neurons_per_layer[i+1] * (num_neurons_per_layer[i]+1); j++) {
+            file_stream << m_weights[i][j] << " ";
+        }
+        file_stream << endl;
+    }
+    file_stream.close();
+
+    if(rename(tmp_file_name.c_str(), checkpoint_file_name.c_str())) {
+        cerr << "Error: failed to write " << checkpoint_file_name << endl;
+        return;
+    }
+    checkpoint_step = step;
+}
+
+// Set blocking and threading of each layer's forward product
+void mlp_t::tune_layers() {
+    layer_plans = new gemm_plan_t[total_layers_index];
+    for(unsigned i = 0; i < total_layers_index; i++) {
+        layer_plans[i] = default_plan(num_neurons_per_layer[i+1], num_neurons_per_layer[i]+1);
+    }
+    if(!tuning_cache_file_name.size()) return;
+
+    // Benchmark only the layer shapes that are not in the tuning cache yet.
+    tuner_t tuner(tuning_cache_file_name);
+    tuner.load_cache();
+    bool tuned = false;
+    for(unsigned i = 0; i < total_layers_index; i++) {
+        unsigned rows = num_neurons_per_layer[i+1];
+        unsigned cols = num_neurons_per_layer[i]+1;
+        if(!tuner.find_plan(rows, cols, layer_plans[i])) {
+            layer_plans[i] = tuner.tune(rows, cols, weights[i]);
+            tuned = true;
+        }
+    }
+    if(tuned) tuner.save_cache();
 }
 
 // Convert big endian to little endian (for 32bit integer)
@@ -324,8 +461,24 @@ void mlp_t::mlp_test() {
 			neuron[j][num_neurons_per_layer[j]] = 1.0;
 		}
 		
-		inner_product(neuron, weights);
-		softmax(neuron[total_layers_index]);
+		// Reuse the result of an identical image if it is cached.
+		uint64_t key = 0, generation = 0;
+		bool cached = false;
+		if(infer_cache) {
+			key = infer_cache->hash(neuron[0]);
+			generation = infer_cache->get_generation();
+			cached = infer_cache->lookup(key, neuron[0], neuron[total_layers_index]);
+		}
+		if(!cached) {
+			chrono::steady_clock::time_point start;
+			if(infer_cache) start = chrono::steady_clock::now();
+			inner_product(neuron, weights);
+			softmax(neuron[total_layers_index]);
+			if(infer_cache) {
+				uint64_t compute_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+				infer_cache->insert(key, generation, neuron[0], neuron[total_layers_index], compute_ns);
+			}
+		}
 		cout << endl;
 		for(unsigned j = 0; j < 10; j++) {
 			cout << neuron[2][j] << " ";
@@ -347,6 +500,7 @@ void mlp_t::mlp_test() {
 		}
 	}
 	cout << double(count) / double(test_set_size) << endl;
+	if(infer_cache) infer_cache->print_stats();
 }
 
 
@@ -366,54 +520,91 @@ void mlp_t::mlp_training() {
 		*/
 
 //#endifi
-		// Initializing
-		for(unsigned j = 0; j < total_layers_index; j++) {
-			for(unsigned k = 0; k < num_neurons_per_layer[j]; k++) {
-				neuron[j][k] = 0;
-			}
-		}
+		train_step(i, layer_plans);
+	}
+	// Weights are updated by training, so cached results are no longer valid.
+	if(infer_cache) infer_cache->invalidate();
+}
 
-		// Setting input image
-		for(unsigned j = 0; j < num_neurons_in_input_layer; j++) {
-				neuron[0][j] = train_img_set[i*num_neurons_in_input_layer+j];
+// Train with one image of the training set
+void mlp_t::train_step(unsigned index, const gemm_plan_t *plans) {
+	// Initializing
+	for(unsigned j = 0; j < total_layers_index; j++) {
+		for(unsigned k = 0; k < num_neurons_per_layer[j]; k++) {
+			neuron[j][k] = 0;
 		}
+	}
 
-		// Setting Bias
-		for(unsigned j = 0; j < total_layers_index; j++) {
-			neuron[j][num_neurons_per_layer[j]] = 1.0;
-		}
+	// Setting input image
+	for(unsigned j = 0; j < num_neurons_in_input_layer; j++) {
+		neuron[0][j] = train_img_set[index*num_neurons_in_input_layer+j];
+	}
 
-		inner_product(neuron, weights);
-		for(unsigned j = 0; j < 10; j++) {
-			cout << neuron[2][j] << " ";
-		}
-		cout << endl;
+	// Setting Bias
+	for(unsigned j = 0; j < total_layers_index; j++) {
+		neuron[j][num_neurons_per_layer[j]] = 1.0;
+	}
 
-		softmax(neuron[total_layers_index]);
-		cout << endl;
-		for(unsigned j = 0; j < 10; j++) {
-			cout << neuron[2][j] << " ";
+	inner_product(neuron, weights, plans);
+	softmax(neuron[total_layers_index]);
+
+	//Setting answer set
+	for(unsigned k = 0; k < num_neurons_per_layer[total_layers_index]; k++) {
+		if(k == unsigned(train_label_set[index])) {
+			answer_set[k] = 1.0;
 		}
-		cout << endl << train_label_set[i] << endl;
+		else {
+			answer_set[k] = 0.0;
+		}
+	}
 
+	loss = 0.0;
+	for(unsigned k = 0; k < num_neurons_per_layer[total_layers_index]; k++) {
+		loss -= answer_set[k] * log(neuron[total_layers_index][k]);
+	}
 
-		//Setting answer set
-		for(unsigned k = 0; k < num_neurons_per_layer[total_layers_index]; k++) {
-			if(k == unsigned(train_label_set[i])) {
-				answer_set[k] = 1.0;
-			}
-			else {
-				answer_set[k] = 0.0;
-			}
+	backward_propagation();
+}
+
+// Count correct answers for test images [begin, end) in steps of stride.
+// Neurons are allocated here, so that it can run alongside training.
+unsigned mlp_t::evaluate(double **m_weights, const gemm_plan_t *plans,
+                         unsigned begin, unsigned end, unsigned stride) {
+	double **neurons = new double*[num_layers];
+	for(unsigned i = 0; i < num_layers; i++) {
+		neurons[i] = new double[num_neurons_per_layer[i]+1];
+	}
+	// Setting Bias
+	for(unsigned i = 0; i < total_layers_index; i++) {
+		neurons[i][num_neurons_per_layer[i]] = 1.0;
+	}
+
+	unsigned count = 0;
+	for(unsigned i = begin; i < end; i += stride) {
+		for(unsigned j = 0; j < num_neurons_in_input_layer; j++) {
+			neurons[0][j] = test_img_set[i*num_neurons_in_input_layer+j];
 		}
+		inner_product(neurons, m_weights, plans);
+		softmax(neurons[total_layers_index]);
 
-		loss = 0.0;
-		for(unsigned k = 0; k < num_neurons_per_layer[total_layers_index]; k++) {
-			loss -= answer_set[k] * log(neuron[total_layers_index][k]);
+		double max = 0.0;
+		unsigned max_index = 0;
+		for(unsigned j = 0; j < num_neurons_per_layer[total_layers_index]; j++) {
+			if(neurons[total_layers_index][j] > max) {
+				max = neurons[total_layers_index][j];
+				max_index = j;
+			}
 		}
-		
-		backward_propagation();
+		if(max_index == test_label_set[i]) {
+			count++;
+		}
+	}
+
+	for(unsigned i = 0; i < num_layers; i++) {
+		delete [] neurons[i];
 	}
+	delete [] neurons;
+	return count;
 }
 
 /*
@@ -443,14 +634,16 @@ void mlp_t::forward_propagation() {
 */
 
 void mlp_t::inner_product(double **neurons, double **weight) {
+    inner_product(neurons, weight, layer_plans);
+}
+
+void mlp_t::inner_product(double **neurons, double **weight, const gemm_plan_t *plans) {
     for(unsigned l = 0; l < total_layers_index; l++) {
+        forward_product(plans[l], num_neurons_per_layer[l+1], num_neurons_per_layer[l]+1,
+                        weight[l], neurons[l], neurons[l+1]);
+        if(l+1 == total_layers_index) continue;
         for(unsigned j = 0; j < num_neurons_per_layer[l+1]; j++) {
-            double sum = 0.0;
-            for(unsigned k = 0; k < num_neurons_per_layer[l]+1; k++){
-                sum += weight[l][j*(num_neurons_per_layer[l]+1)+k] * neurons[l][k];
-			}
-            if(l+1 == total_layers_index) neurons[l+1][j] = sum;
-            else neurons[l+1][j] = relu(sum);
+            neurons[l+1][j] = relu(neurons[l+1][j]);
         }
     }
 }
@@ -471,6 +664,12 @@ void mlp_t::softmax(double *neurons) {
     }
 }
 
+// Not tuned by tuner_t. For each j, the tmp reduction and the weight update
+// walk k with stride num_neurons_per_layer[l], so j = 0 writes the element that
+// j = n reads and the j loop must stay in order. Blocking the k reduction keeps
+// a single sequential sum, so there is nothing to tune. Splitting the k update
+// over threads is exact but needs a join for every j, which costs more than
+// the update it splits.
 void mlp_t::backward_propagation() {
 	// Initialize delta
 	//cout << weights[1][500] << endl;
@@ -6,8 +6,14 @@
  *****************************************************/
 
 #include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
+#include "infer_cache.h"
+#include "scheduler.h"
+#include "tuner.h"
 
 typedef uint8_t data_type_t;
 
@@ -27,12 +33,22 @@ public:
     void read_train_img_file();
     void read_train_label_file();
     void load_weights();
+    void tune_layers();
     //void forward_propagation();
     void backward_propagation();
     void mlp_test();
     void mlp_training();
+    void train_step(unsigned index, const gemm_plan_t *plans);
+    unsigned evaluate(double **m_weights, const gemm_plan_t *plans,
+                      unsigned begin, unsigned end, unsigned stride);
+    double **snapshot_weights();                         // Copy of the current weights
+    void delete_weights(double **m_weights);
+    void export_weights(double **m_weights, unsigned step);
+    bool is_async();
+    void mlp_async();                                    // Load, train, evaluate and checkpoint concurrently
 
     void inner_product(double **neuron, double **weights);
+    void inner_product(double **neuron, double **weights, const gemm_plan_t *plans);
     void softmax(double *neuron); 
     
     int big_to_little_endian_int32(int x);
@@ -40,9 +56,19 @@ public:
     double relu(double x);
     double drelu(double x);
 private:
+    task_t<void> async_main(scheduler_t &scheduler, async_semaphore_t &eval_slots, unsigned num_chunks,
+                            const gemm_plan_t *train_plans, const gemm_plan_t *eval_plans);
+    task_t<void> load_task(void (mlp_t::*read_file)());
+    task_t<void> eval_task(scheduler_t &scheduler, async_semaphore_t &eval_slots, const gemm_plan_t *plans,
+                           std::shared_ptr<double*> snapshot, unsigned num_chunks, unsigned step);
+    task_t<unsigned> eval_chunk_task(async_semaphore_t &eval_slots, const gemm_plan_t *plans,
+                                     std::shared_ptr<double*> snapshot, unsigned chunk, unsigned num_chunks);
+    task_t<void> checkpoint_task(std::shared_ptr<double*> snapshot, unsigned step);
+
     double **neuron;
     unsigned width, length;
     bool require_training;
+    infer_cache_t *infer_cache;                          // Optional inference result cache
 
     std::string config_file_name;                        // Configuration file name
     std::string test_img_file_name;                      // Test img file for inferencing
@@ -50,6 +76,8 @@ private:
     std::string train_img_file_name;                     // MLP train img file name
     std::string train_label_file_name;                   // MLP train label file name 
     std::string weight_file_name;                        // Pre-trained weight file name 
+    std::string tuning_cache_file_name;                  // Autotuned layer plans file name
+    std::string checkpoint_file_name;                    // Weight checkpoint file name
 
     unsigned num_layers;
     unsigned total_layers_index;
@@ -65,7 +93,16 @@ private:
     double *train_label_set;
 	double *answer_set;
     double **weights;
+    gemm_plan_t *layer_plans;                            // Forward product plan of each layer
     double **delta;
     double learning_rate;
 	double loss;
+
+    unsigned num_threads;                                // Scheduler threads (0 runs sequentially)
+    unsigned eval_interval;                              // # of training images between evaluations
+    double eval_core_share;                              // Share of threads evaluation may take
+    std::mutex checkpoint_lock;
+    unsigned checkpoint_step;                            // # of training images of the last checkpoint
+    std::atomic<bool> eval_running;                      // A spawned evaluation is in flight
+    std::atomic<bool> checkpoint_running;                // A spawned checkpoint is in flight
 };
@@ -0,0 +1,147 @@
+/*****************************************************
+   Multi-Level Perceptron (MLP) in C++
+   Written by Intelligent Computing Systems Lab (ICSL)
+   School of Electrical Engineering
+   Yonsei University, Seoul,  South Korea
+ *****************************************************/
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "mlp.h"
+
+using namespace std;
+
+bool mlp_t::is_async() {
+    return num_threads > 0;
+}
+
+void mlp_t::mlp_async() {
+    // Evaluation takes eval_core_share of num_threads, checked in initialize()
+    // to be at least one thread and to leave one for training.
+    unsigned eval_threads = unsigned(eval_core_share * num_threads);
+    unsigned train_threads = num_threads - eval_threads;
+
+    // Training keeps its tuned plans, up to the threads left by evaluation.
+    // Evaluation computes every product on the worker that holds its slot.
+    vector<gemm_plan_t> train_plans(layer_plans, layer_plans + total_layers_index);
+    vector<gemm_plan_t> eval_plans(layer_plans, layer_plans + total_layers_index);
+    unsigned train_plan_threads = 1;
+    for(unsigned i = 0; i < total_layers_index; i++) {
+        train_plans[i].num_threads = min(train_plans[i].num_threads, train_threads);
+        train_plan_threads = max(train_plan_threads, train_plans[i].num_threads);
+        eval_plans[i].num_threads = 1;
+    }
+
+    // The worker that runs training starts train_plan_threads-1 threads of its
+    // own, so the pool is smaller by that many to stay within num_threads.
+    scheduler_t scheduler(num_threads - (train_plan_threads - 1));
+    async_semaphore_t eval_slots(scheduler, eval_threads, PRIORITY_LOW);
+
+    // Returns after training and every evaluation and checkpoint are done.
+    scheduler.run(async_main(scheduler, eval_slots, eval_threads, &train_plans[0], &eval_plans[0]));
+
+    // Weights are updated by training, so cached results are no longer valid.
+    if(infer_cache) infer_cache->invalidate();
+}
+
+task_t<void> mlp_t::async_main(scheduler_t &scheduler, async_semaphore_t &eval_slots, unsigned num_chunks,
+                               const gemm_plan_t *train_plans, const gemm_plan_t *eval_plans) {
+    // Load the test set in the background. It is only needed by evaluation.
+    when_all_latch_t test_loaded;
+    test_loaded.count = 3;                               // 2 loads + 1 for the awaiter
+    test_loaded.scheduler = &scheduler;
+    test_loaded.priority = PRIORITY_HIGH;
+    when_all_run(&scheduler, load_task(&mlp_t::read_test_img_file), &test_loaded, PRIORITY_NORMAL);
+    when_all_run(&scheduler, load_task(&mlp_t::read_test_label_file), &test_loaded, PRIORITY_NORMAL);
+    bool test_set_ready = false;
+
+    if(!require_training) {
+        co_await test_loaded;
+        shared_ptr<double*> snapshot(snapshot_weights(), [this](double **m_weights) { delete_weights(m_weights); });
+        co_await eval_task(scheduler, eval_slots, eval_plans, snapshot, num_chunks, 0);
+        co_return;
+    }
+
+    // Training starts as soon as the training set is loaded.
+    vector<task_t<void> > loads;
+    loads.push_back(load_task(&mlp_t::read_train_img_file));
+    loads.push_back(load_task(&mlp_t::read_train_label_file));
+    co_await when_all(scheduler, std::move(loads), PRIORITY_HIGH);
+
+    for(unsigned begin = 0; begin < train_set_size; begin += eval_interval) {
+        unsigned end = min(begin + eval_interval, train_set_size);
+        for(unsigned i = begin; i < end; i++) {
+            train_step(i, train_plans);
+        }
+
+        stringstream message;
+        message << end << "th is done." << endl << loss << endl;
+        cout << message.str();
+        if(end == train_set_size) break;
+
+        // Evaluate and export a snapshot of the weights while training goes on.
+        // A snapshot is skipped if the previous one is still being processed.
+        bool start_eval = !eval_running.exchange(true);
+        bool start_checkpoint = checkpoint_file_name.size() && !checkpoint_running.exchange(true);
+        if(!start_eval && !start_checkpoint) continue;
+
+        shared_ptr<double*> snapshot(snapshot_weights(), [this](double **m_weights) { delete_weights(m_weights); });
+        if(start_eval) {
+            if(!test_set_ready) {
+                co_await test_loaded;
+                test_set_ready = true;
+            }
+            scheduler.spawn(eval_task(scheduler, eval_slots, eval_plans, snapshot, num_chunks, end), PRIORITY_LOW);
+        }
+        if(start_checkpoint) {
+            scheduler.spawn(checkpoint_task(snapshot, end), PRIORITY_NORMAL);
+        }
+    }
+
+    // Final weights are always evaluated and exported.
+    shared_ptr<double*> snapshot(snapshot_weights(), [this](double **m_weights) { delete_weights(m_weights); });
+    if(checkpoint_file_name.size()) {
+        scheduler.spawn(checkpoint_task(snapshot, train_set_size), PRIORITY_NORMAL);
+    }
+    if(!test_set_ready) co_await test_loaded;
+    co_await eval_task(scheduler, eval_slots, eval_plans, snapshot, num_chunks, train_set_size);
+}
+
+task_t<void> mlp_t::load_task(void (mlp_t::*read_file)()) {
+    (this->*read_file)();
+    co_return;
+}
+
+task_t<void> mlp_t::eval_task(scheduler_t &scheduler, async_semaphore_t &eval_slots, const gemm_plan_t *plans,
+                              shared_ptr<double*> snapshot, unsigned num_chunks, unsigned step) {
+    vector<task_t<unsigned> > chunks;
+    for(unsigned c = 0; c < num_chunks; c++) {
+        chunks.push_back(eval_chunk_task(eval_slots, plans, snapshot, c, num_chunks));
+    }
+    vector<unsigned> counts = co_await when_all(scheduler, std::move(chunks), PRIORITY_LOW);
+
+    unsigned count = 0;
+    for(unsigned c = 0; c < counts.size(); c++) {
+        count += counts[c];
+    }
+    stringstream message;
+    message << "Accuracy after " << step << " training images: "
+            << double(count) / double(test_set_size) << endl;
+    cout << message.str();
+    eval_running = false;
+}
+
+task_t<unsigned> mlp_t::eval_chunk_task(async_semaphore_t &eval_slots, const gemm_plan_t *plans,
+                                        shared_ptr<double*> snapshot, unsigned chunk, unsigned num_chunks) {
+    co_await eval_slots.acquire();
+    unsigned count = evaluate(snapshot.get(), plans, chunk, test_set_size, num_chunks);
+    eval_slots.release();
+    co_return count;
+}
+
+task_t<void> mlp_t::checkpoint_task(shared_ptr<double*> snapshot, unsigned step) {
+    export_weights(snapshot.get(), step);
+    checkpoint_running = false;
+    co_return;
+}
@@ -0,0 +1,154 @@
+/*****************************************************
+   Multi-Level Perceptron (MLP) in C++
+   Written by Intelligent Computing Systems Lab (ICSL)
+   School of Electrical Engineering
+   Yonsei University, Seoul,  South Korea
+ *****************************************************/
+
+#include "scheduler.h"
+
+using namespace std;
+
+// Worker that the current thread belongs to
+static thread_local scheduler_t *current_scheduler = NULL;
+static thread_local unsigned current_worker = 0;
+
+scheduler_t::scheduler_t(unsigned m_num_threads) :
+    num_threads(m_num_threads ? m_num_threads : 1),
+    workers(NULL),
+    num_pending(0),
+    stopping(false),
+    num_outstanding(0),
+    next_worker(0) {
+    workers = new worker_t[num_threads];
+    for(unsigned i = 0; i < num_threads; i++) {
+        threads.push_back(thread(&scheduler_t::worker_loop, this, i));
+    }
+}
+
+scheduler_t::~scheduler_t() {
+    {
+        lock_guard<mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    sleep_cond.notify_all();
+    for(unsigned i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    delete [] workers;
+}
+
+void scheduler_t::post(coroutine_handle<> handle, unsigned priority) {
+    if(priority >= NUM_PRIORITIES) priority = PRIORITY_LOW;
+
+    // Workers keep their own work local. Others spread it round robin.
+    unsigned id = (current_scheduler == this) ? current_worker : next_worker++ % num_threads;
+    {
+        // Count and publish together, so that a worker never takes the
+        // handle before num_pending includes it.
+        lock_guard<mutex> guard(sleep_lock);
+        num_pending++;
+        lock_guard<mutex> queue_guard(workers[id].lock);
+        workers[id].queues[priority].push_back(handle);
+    }
+    sleep_cond.notify_one();
+}
+
+detached_t scheduler_t::run_detached(scheduler_t *scheduler, task_t<void> m_task, unsigned priority) {
+    co_await scheduler->schedule(priority);
+    {
+        task_t<void> task = std::move(m_task);
+        co_await task;
+    }
+    scheduler->task_done();
+}
+
+void scheduler_t::spawn(task_t<void> m_task, unsigned priority) {
+    {
+        lock_guard<mutex> guard(idle_lock);
+        num_outstanding++;
+    }
+    run_detached(this, std::move(m_task), priority);
+}
+
+void scheduler_t::run(task_t<void> m_task) {
+    spawn(std::move(m_task), PRIORITY_HIGH);
+
+    unique_lock<mutex> guard(idle_lock);
+    idle_cond.wait(guard, [this] { return !num_outstanding; });
+}
+
+void scheduler_t::task_done() {
+    lock_guard<mutex> guard(idle_lock);
+    if(!--num_outstanding) idle_cond.notify_all();
+}
+
+detached_t when_all_run(scheduler_t *scheduler, task_t<void> m_task,
+                        when_all_latch_t *latch, unsigned priority) {
+    co_await scheduler->schedule(priority);
+    co_await m_task;
+    latch->count_down();
+}
+
+task_t<void> when_all(scheduler_t &scheduler, vector<task_t<void> > tasks, unsigned priority) {
+    when_all_latch_t latch;
+    latch.count = tasks.size() + 1;
+    latch.scheduler = &scheduler;
+    latch.priority = priority;
+    for(unsigned i = 0; i < tasks.size(); i++) {
+        when_all_run(&scheduler, std::move(tasks[i]), &latch, priority);
+    }
+    co_await latch;
+}
+
+// Own queue is used in LIFO order for locality.
+bool scheduler_t::pop(unsigned id, unsigned priority, coroutine_handle<> &handle) {
+    lock_guard<mutex> guard(workers[id].lock);
+    deque<coroutine_handle<> > &queue = workers[id].queues[priority];
+    if(!queue.size()) return false;
+    handle = queue.back();
+    queue.pop_back();
+    return true;
+}
+
+// Other workers' queues are stolen from in FIFO order.
+bool scheduler_t::steal(unsigned id, unsigned priority, coroutine_handle<> &handle) {
+    for(unsigned i = 1; i < num_threads; i++) {
+        worker_t &victim = workers[(id + i) % num_threads];
+        lock_guard<mutex> guard(victim.lock);
+        deque<coroutine_handle<> > &queue = victim.queues[priority];
+        if(!queue.size()) continue;
+        handle = queue.front();
+        queue.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void scheduler_t::worker_loop(unsigned id) {
+    current_scheduler = this;
+    current_worker = id;
+
+    while(true) {
+        // Higher priority work anywhere in the pool goes first.
+        coroutine_handle<> handle;
+        bool found = false;
+        for(unsigned p = 0; p < NUM_PRIORITIES && !found; p++) {
+            found = pop(id, p, handle) || steal(id, p, handle);
+        }
+
+        if(found) {
+            {
+                lock_guard<mutex> guard(sleep_lock);
+                num_pending--;
+            }
+            handle.resume();
+            continue;
+        }
+
+        unique_lock<mutex> guard(sleep_lock);
+        if(stopping) return;
+        sleep_cond.wait(guard, [this] { return stopping || num_pending; });
+        if(stopping && !num_pending) return;
+    }
+}
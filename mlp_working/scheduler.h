@@ -0,0 +1,249 @@
+/*****************************************************
+   Multi-Level Perceptron (MLP) in C++
+   Written by Intelligent Computing Systems Lab (ICSL)
+   School of Electrical Engineering
+   Yonsei University, Seoul,  South Korea
+ *****************************************************/
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Task priorities. Lower value runs first.
+enum TASK_PRIORITY { PRIORITY_HIGH = 0, PRIORITY_NORMAL, PRIORITY_LOW, NUM_PRIORITIES };
+
+template<typename T> class task_t;
+
+// Resume whoever awaits the finished task (symmetric transfer).
+struct final_awaiter_t {
+    bool await_ready() noexcept { return false; }
+    template<typename P> std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().continuation;
+        if(continuation) return continuation;
+        return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+};
+
+struct promise_base_t {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    final_awaiter_t final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template<typename T> struct promise_t : promise_base_t {
+    T value;
+
+    task_t<T> get_return_object();
+    void return_value(T m_value) { value = std::move(m_value); }
+    T result() {
+        if(exception) std::rethrow_exception(exception);
+        return std::move(value);
+    }
+};
+
+template<> struct promise_t<void> : promise_base_t {
+    task_t<void> get_return_object();
+    void return_void() {}
+    void result() {
+        if(exception) std::rethrow_exception(exception);
+    }
+};
+
+// Lazily started coroutine. It runs when it is awaited, on the thread of the awaiter.
+template<typename T> class task_t {
+public:
+    typedef promise_t<T> promise_type;
+
+    task_t() : handle(nullptr) {}
+    explicit task_t(std::coroutine_handle<promise_type> m_handle) : handle(m_handle) {}
+    task_t(task_t &&m_task) : handle(m_task.handle) { m_task.handle = nullptr; }
+    task_t &operator=(task_t &&m_task) {
+        if(this != &m_task) {
+            if(handle) handle.destroy();
+            handle = m_task.handle;
+            m_task.handle = nullptr;
+        }
+        return *this;
+    }
+    task_t(const task_t&) = delete;
+    task_t &operator=(const task_t&) = delete;
+    ~task_t() { if(handle) handle.destroy(); }
+
+    bool await_ready() { return !handle || handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> m_continuation) {
+        handle.promise().continuation = m_continuation;
+        return handle;
+    }
+    T await_resume() { return handle.promise().result(); }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<typename T> task_t<T> promise_t<T>::get_return_object() {
+    return task_t<T>(std::coroutine_handle<promise_t<T> >::from_promise(*this));
+}
+
+inline task_t<void> promise_t<void>::get_return_object() {
+    return task_t<void>(std::coroutine_handle<promise_t<void> >::from_promise(*this));
+}
+
+// Eagerly started coroutine that destroys itself when it finishes
+struct detached_t {
+    struct promise_type {
+        detached_t get_return_object() { return detached_t(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Work-stealing thread pool that runs coroutines
+class scheduler_t {
+public:
+    scheduler_t(unsigned m_num_threads);                 // Scheduler constructor
+    virtual ~scheduler_t();                              // Scheduler destructor
+
+    // co_await schedule(p) continues the coroutine on a worker with priority p.
+    struct schedule_awaiter_t {
+        scheduler_t *scheduler;
+        unsigned priority;
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { scheduler->post(handle, priority); }
+        void await_resume() {}
+    };
+    schedule_awaiter_t schedule(unsigned priority) { return schedule_awaiter_t{this, priority}; }
+
+    void post(std::coroutine_handle<> handle, unsigned priority);
+    void spawn(task_t<void> m_task, unsigned priority); // Run a task in the background
+    void run(task_t<void> m_task);                       // Run a task and wait for all spawned tasks
+    unsigned get_num_threads() { return num_threads; }
+
+private:
+    struct worker_t {
+        std::mutex lock;
+        std::deque<std::coroutine_handle<> > queues[NUM_PRIORITIES];
+    };
+
+    static detached_t run_detached(scheduler_t *scheduler, task_t<void> m_task, unsigned priority);
+    void worker_loop(unsigned id);
+    bool pop(unsigned id, unsigned priority, std::coroutine_handle<> &handle);
+    bool steal(unsigned id, unsigned priority, std::coroutine_handle<> &handle);
+    void task_done();
+
+    unsigned num_threads;
+    worker_t *workers;
+    std::vector<std::thread> threads;
+
+    std::mutex sleep_lock;
+    std::condition_variable sleep_cond;
+    unsigned num_pending;                                // Queued coroutines (guarded by sleep_lock)
+    bool stopping;
+
+    std::mutex idle_lock;
+    std::condition_variable idle_cond;
+    unsigned num_outstanding;                            // Unfinished spawned tasks (guarded by idle_lock)
+
+    std::atomic<unsigned> next_worker;                   // Round robin for posts from outside the pool
+};
+
+// Coroutine semaphore. Waiters are resumed through the scheduler.
+class async_semaphore_t {
+public:
+    async_semaphore_t(scheduler_t &m_scheduler, unsigned m_count, unsigned m_priority) :
+        scheduler(m_scheduler), count(m_count), priority(m_priority) {}
+
+    struct acquire_awaiter_t {
+        async_semaphore_t *semaphore;
+        bool await_ready() { return false; }
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> guard(semaphore->lock);
+            if(semaphore->count) { semaphore->count--; return false; }
+            semaphore->waiters.push_back(handle);
+            return true;
+        }
+        void await_resume() {}
+    };
+    acquire_awaiter_t acquire() { return acquire_awaiter_t{this}; }
+
+    void release() {
+        std::coroutine_handle<> waiter;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if(!waiters.size()) { count++; return; }
+            waiter = waiters.front();
+            waiters.pop_front();
+        }
+        // The slot is handed over to the waiter directly.
+        scheduler.post(waiter, priority);
+    }
+
+private:
+    scheduler_t &scheduler;
+    std::mutex lock;
+    unsigned count;
+    unsigned priority;
+    std::deque<std::coroutine_handle<> > waiters;
+};
+
+// Counts finished when_all() tasks. The awaiter is resumed after the last one.
+struct when_all_latch_t {
+    std::atomic<unsigned> count;                         // # of tasks + 1 for the awaiter
+    std::coroutine_handle<> continuation;
+    scheduler_t *scheduler;
+    unsigned priority;
+
+    void count_down() {
+        if(!--count) scheduler->post(continuation, priority);
+    }
+    bool await_ready() { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        continuation = handle;
+        return --count != 0;
+    }
+    void await_resume() {}
+};
+
+template<typename T> detached_t when_all_run(scheduler_t *scheduler, task_t<T> m_task, T *result,
+                                             when_all_latch_t *latch, unsigned priority) {
+    co_await scheduler->schedule(priority);
+    *result = co_await m_task;
+    latch->count_down();
+}
+
+detached_t when_all_run(scheduler_t *scheduler, task_t<void> m_task,
+                        when_all_latch_t *latch, unsigned priority);
+
+// Run tasks in parallel on the scheduler, and wait for all of them.
+task_t<void> when_all(scheduler_t &scheduler, std::vector<task_t<void> > tasks, unsigned priority);
+
+// Run tasks in parallel on the scheduler, and collect their results in order.
+template<typename T> task_t<std::vector<T> > when_all(scheduler_t &scheduler, std::vector<task_t<T> > tasks,
+                                                      unsigned priority) {
+    std::vector<T> results(tasks.size());
+    when_all_latch_t latch;
+    latch.count = tasks.size() + 1;
+    latch.scheduler = &scheduler;
+    latch.priority = priority;
+    for(unsigned i = 0; i < tasks.size(); i++) {
+        when_all_run(&scheduler, std::move(tasks[i]), &results[i], &latch, priority);
+    }
+    co_await latch;
+    co_return results;
+}
+
+#endif
@@ -0,0 +1,216 @@
+/*****************************************************
+   Multi-Level Perceptron (MLP) in C++
+   Written by Intelligent Computing Systems Lab (ICSL)
+   School of Electrical Engineering
+   Yonsei University, Seoul,  South Korea
+ *****************************************************/
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "tuner.h"
+
+using namespace std;
+
+// Blocked product over output neurons [begin, end)
+static void forward_product_range(const gemm_plan_t &plan, unsigned begin, unsigned end, unsigned cols,
+                                  const double *weight, const double *in, double *out) {
+    for(unsigned jb = begin; jb < end; jb += plan.tile_rows) {
+        unsigned j_end = min(jb + plan.tile_rows, end);
+        for(unsigned j = jb; j < j_end; j++) {
+            out[j] = 0.0;
+        }
+        for(unsigned kb = 0; kb < cols; kb += plan.tile_cols) {
+            unsigned k_end = min(kb + plan.tile_cols, cols);
+            for(unsigned j = jb; j < j_end; j++) {
+                const double *w = weight + size_t(j) * cols;
+                double sum = out[j];
+                for(unsigned k = kb; k < k_end; k++) {
+                    sum += w[k] * in[k];
+                }
+                out[j] = sum;
+            }
+        }
+    }
+}
+
+void forward_product(const gemm_plan_t &plan, unsigned rows, unsigned cols,
+                     const double *weight, const double *in, double *out) {
+    unsigned num_threads = min(plan.num_threads, rows);
+    if(num_threads <= 1) {
+        forward_product_range(plan, 0, rows, cols, weight, in, out);
+        return;
+    }
+
+    // The calling thread takes the first chunk of output neurons.
+    unsigned chunk = (rows + num_threads - 1) / num_threads;
+    vector<thread> threads;
+    for(unsigned t = 1; t < num_threads; t++) {
+        unsigned begin = t * chunk;
+        unsigned end = min(begin + chunk, rows);
+        if(begin >= end) break;
+        threads.push_back(thread(forward_product_range, cref(plan), begin, end, cols, weight, in, out));
+    }
+    forward_product_range(plan, 0, min(chunk, rows), cols, weight, in, out);
+    for(unsigned t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+}
+
+gemm_plan_t default_plan(unsigned rows, unsigned cols) {
+    gemm_plan_t plan;
+    plan.tile_rows = rows ? rows : 1;
+    plan.tile_cols = cols ? cols : 1;
+    plan.num_threads = 1;
+    return plan;
+}
+
+tuner_t::tuner_t(string m_cache_file_name) :
+    cache_file_name(m_cache_file_name),
+    max_threads(thread::hardware_concurrency()) {
+    if(!max_threads) max_threads = 1;
+    cpu_model = read_cpu_model();
+}
+
+tuner_t::~tuner_t() {
+}
+
+// Read CPU model name from /proc/cpuinfo
+string tuner_t::read_cpu_model() {
+    fstream file_stream;
+    file_stream.open("/proc/cpuinfo", fstream::in);
+
+    string line;
+    while(getline(file_stream, line)) {
+        if(line.compare(0, 10, "model name")) continue;
+        size_t pos = line.find(':');
+        if(pos == string::npos) continue;
+        pos = line.find_first_not_of(" \t", pos + 1);
+        if(pos == string::npos) break;
+        return line.substr(pos);
+    }
+    return "unknown";
+}
+
+string tuner_t::make_key(string m_cpu_model, unsigned rows, unsigned cols) {
+    stringstream key;
+    key << m_cpu_model << '\t' << rows << '\t' << cols;
+    return key.str();
+}
+
+// Cache file format: one plan per line, tab separated
+// <cpu model> <rows> <cols> <tile_rows> <tile_cols> <num_threads>
+void tuner_t::load_cache() {
+    fstream file_stream;
+    file_stream.open(cache_file_name.c_str(), fstream::in);
+    if(!file_stream.is_open()) return;                   // Not tuned yet
+
+    string line;
+    while(getline(file_stream, line)) {
+        if(!line.size() || line[0] == '#') continue;
+        size_t pos = line.find('\t');
+        if(pos == string::npos) continue;
+
+        unsigned rows, cols;
+        gemm_plan_t plan;
+        stringstream fields(line.substr(pos + 1));
+        if(!(fields >> rows >> cols >> plan.tile_rows >> plan.tile_cols >> plan.num_threads) ||
+           !plan.tile_rows || !plan.tile_cols || !plan.num_threads) {
+            cerr << "Warning: ignoring malformed line in " << cache_file_name << endl;
+            continue;
+        }
+        plans[make_key(line.substr(0, pos), rows, cols)] = plan;
+    }
+}
+
+void tuner_t::save_cache() {
+    fstream file_stream;
+    file_stream.open(cache_file_name.c_str(), fstream::out|fstream::trunc);
+
+    if(!file_stream.is_open()) {
+        cerr << "Error: failed to open " << cache_file_name << endl;
+        return;
+    }
+    file_stream << "# cpu_model\trows\tcols\ttile_rows\ttile_cols\tnum_threads" << endl;
+    for(map<string, gemm_plan_t>::iterator it = plans.begin(); it != plans.end(); it++) {
+        file_stream << it->first << '\t' << it->second.tile_rows << '\t'
+                    << it->second.tile_cols << '\t' << it->second.num_threads << endl;
+    }
+}
+
+bool tuner_t::find_plan(unsigned rows, unsigned cols, gemm_plan_t &plan) {
+    map<string, gemm_plan_t>::iterator it = plans.find(make_key(cpu_model, rows, cols));
+    if(it == plans.end()) return false;
+    plan = it->second;
+    // Same CPU model may come with fewer cores available.
+    plan.num_threads = min(plan.num_threads, max_threads);
+    return true;
+}
+
+// Best of a few trials of the average time per product (in seconds)
+double tuner_t::measure(const gemm_plan_t &plan, unsigned rows, unsigned cols,
+                        const double *weight, const double *in, double *out) {
+    // Repeat enough products for each trial to be measurable.
+    unsigned repeats = 1 + (1 << 20) / (rows * cols + 1);
+    double best = 0.0;
+    for(unsigned trial = 0; trial < 3; trial++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(unsigned r = 0; r < repeats; r++) {
+            forward_product(plan, rows, cols, weight, in, out);
+        }
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count() / repeats;
+        if(!trial || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+gemm_plan_t tuner_t::tune(unsigned rows, unsigned cols, const double *weight) {
+    const unsigned candidate_tiles[] = { 4, 8, 16, 32, 64, 128, 256, 512 };
+    const unsigned num_candidate_tiles = sizeof(candidate_tiles) / sizeof(candidate_tiles[0]);
+
+    // Candidate tile sizes that are smaller than the layer, and the whole layer
+    vector<unsigned> tile_rows, tile_cols;
+    for(unsigned i = 0; i < num_candidate_tiles; i++) {
+        if(candidate_tiles[i] < rows) tile_rows.push_back(candidate_tiles[i]);
+        if(candidate_tiles[i] < cols) tile_cols.push_back(candidate_tiles[i]);
+    }
+    tile_rows.push_back(rows);
+    tile_cols.push_back(cols);
+
+    // Candidate thread counts: powers of two up to the # of cores
+    vector<unsigned> num_threads;
+    for(unsigned t = 1; t < max_threads && t < rows; t *= 2) {
+        num_threads.push_back(t);
+    }
+    num_threads.push_back(min(max_threads, rows));
+
+    vector<double> in(cols, 1.0), out(rows);
+    gemm_plan_t best_plan = default_plan(rows, cols);
+    double best_time = measure(best_plan, rows, cols, weight, &in[0], &out[0]);
+
+    for(unsigned t = 0; t < num_threads.size(); t++) {
+        for(unsigned r = 0; r < tile_rows.size(); r++) {
+            for(unsigned c = 0; c < tile_cols.size(); c++) {
+                gemm_plan_t plan;
+                plan.tile_rows = tile_rows[r];
+                plan.tile_cols = tile_cols[c];
+                plan.num_threads = num_threads[t];
+                double elapsed = measure(plan, rows, cols, weight, &in[0], &out[0]);
+                if(elapsed < best_time) {
+                    best_time = elapsed;
+                    best_plan = plan;
+                }
+            }
+        }
+    }
+
+    cout << "Tuned " << rows << "x" << cols << " layer: tile " << best_plan.tile_rows << "x"
+         << best_plan.tile_cols << ", " << best_plan.num_threads << " thread(s), "
+         << best_time * 1e6 << " us" << endl;
+
+    plans[make_key(cpu_model, rows, cols)] = best_plan;
+    return best_plan;
+}
@@ -0,0 +1,58 @@
+/*****************************************************
+   Multi-Level Perceptron (MLP) in C++
+   Written by Intelligent Computing Systems Lab (ICSL)
+   School of Electrical Engineering
+   Yonsei University, Seoul,  South Korea
+ *****************************************************/
+
+#ifndef __TUNER_H__
+#define __TUNER_H__
+
+#include <map>
+#include <string>
+
+// Blocking and threading of one layer's weight-by-neuron product
+struct gemm_plan_t {
+    unsigned tile_rows;                                  // Output neurons per block
+    unsigned tile_cols;                                  // Input neurons per block
+    unsigned num_threads;                                // Output neurons are split over threads
+};
+
+// out[j] = sum_k weight[j*cols+k] * in[k] for j < rows, following the plan.
+// Every output is accumulated in the same order as the untiled loop.
+// With num_threads > 1, new threads are started and joined on every call.
+void forward_product(const gemm_plan_t &plan, unsigned rows, unsigned cols,
+                     const double *weight, const double *in, double *out);
+
+// Default plan: no blocking, single thread
+gemm_plan_t default_plan(unsigned rows, unsigned cols);
+
+// Autotuner for forward_product()
+// Winners are kept in a tuning cache file keyed by CPU model and layer shape.
+// Each candidate is timed with the whole machine to itself, so a tuned
+// num_threads assumes exclusive use of the cores. Callers that run products
+// in parallel should force num_threads = 1.
+// The backward product is not tuned; see backward_propagation() for why.
+class tuner_t {
+public:
+    tuner_t(std::string m_cache_file_name);              // Tuner constructor
+    virtual ~tuner_t();                                  // Tuner destructor
+
+    void load_cache();                                   // Read tuned plans from the cache file
+    void save_cache();                                   // Write tuned plans to the cache file
+    bool find_plan(unsigned rows, unsigned cols, gemm_plan_t &plan);
+    gemm_plan_t tune(unsigned rows, unsigned cols, const double *weight);
+
+private:
+    std::string read_cpu_model();
+    std::string make_key(std::string m_cpu_model, unsigned rows, unsigned cols);
+    double measure(const gemm_plan_t &plan, unsigned rows, unsigned cols,
+                   const double *weight, const double *in, double *out);
+
+    std::string cache_file_name;                         // Tuning cache file name
+    std::string cpu_model;                               // CPU model of this machine
+    unsigned max_threads;
+    std::map<std::string, gemm_plan_t> plans;            // Plans of all CPUs in the cache file
+};
+
+#endif